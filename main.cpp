@@ -8,18 +8,182 @@
 #include <cstdlib>
 #include <ctime>
 #include <fstream>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <condition_variable>
+#include <sstream>
+#ifdef _WIN32
+#define NOMINMAX
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 using namespace std::chrono_literals;
 
 constexpr int TIMEOUT = 400; // maximum number of milliseconds that a player is allowed to take
+constexpr int AUTOSAVE_TURNS = 5; // save the game every this number of turns
+// fallback for slow turns: also save when a turn ends and this much time has passed since the last save.
+// It is not a timer - nothing is saved between turns
+constexpr auto AUTOSAVE_PERIOD = 10s;
 constexpr int gridSideSize = 15;
+constexpr int visionRadius = 2; // how far (in cells, including diagonals) a unit can see
 
 enum class Symbols // this enum class describes all possible symbols on the board and an empty cell
 {
-    s, S, p, P, r, R, M, f, F, empty
+    s, S, p, P, r, R, M, f, F, // new symbols of the board go here, before empty
+    empty,
+    hidden // a cell which the player can't see. It is never placed on the board
 };
 
+// index of a symbol in the rule tables
+constexpr int symbolIndex(Symbols symbol)
+{
+    return static_cast<int>(symbol);
+}
+
+// number of symbols that can be placed on the board
+constexpr int symbolsCount = symbolIndex(Symbols::empty) + 1;
+static_assert(symbolIndex(Symbols::hidden) == symbolsCount, "hidden must follow empty");
+
+// what happens when units of player 0 and player 1 meet in one cell
+enum class Outcome
+{
+    none, // the symbols don't fight (e.g. the cell is empty)
+    draw, // two similar symbols met
+    zeroKills, // unit 0 kills unit 1
+    oneKills // unit 1 kills unit 0
+};
+
+// A rule set is a policy class which describes the game at compile time:
+// - units0, units1: unit types of both players, the i-th units of the players are of the same type
+// - beats: pairs {winner, loser} of indices into the unit lists
+// - flag0, flag1: flags of both players
+// - impassable: terrain which no unit can step on, may be empty (array<Symbols, 0>)
+// To play a variant (e.g. Rock-Paper-Scissors-Lizard-Spock or more terrain types)
+// add its symbols to Symbols (before empty) and write another rule set.
+// The symbols are not derived from the rule set everywhere yet, so a variant also has to edit
+// World::init (initial placement), symbolToChar and chooseSymbol in startSavedGame.
+struct ClassicRules
+{
+    static constexpr array<Symbols, 3> units0 = { Symbols::r, Symbols::p, Symbols::s };
+    static constexpr array<Symbols, 3> units1 = { Symbols::R, Symbols::P, Symbols::S };
+    static constexpr array<pair<int, int>, 3> beats = {{
+            {0, 2}, // rock beats scissors
+            {1, 0}, // paper beats rock
+            {2, 1} // scissors beat paper
+    }};
+    static constexpr Symbols flag0 = Symbols::f;
+    static constexpr Symbols flag1 = Symbols::F;
+    static constexpr array<Symbols, 1> impassable = { Symbols::M };
+};
+
+// bit mask with one bit per symbol from the list
+template<class SymbolList>
+constexpr uint32_t symbolMask(const SymbolList& symbols)
+{
+    uint32_t mask = 0;
+    for (auto symbol : symbols)
+    {
+        mask |= 1u << symbolIndex(symbol);
+    }
+    return mask;
+}
+
+// whether the symbol is in the mask
+constexpr bool inMask(uint32_t mask, Symbols symbol)
+{
+    return (mask >> symbolIndex(symbol)) & 1u;
+}
+
+// whether the rule set is well-formed: all its symbols can be placed on the board
+// and every meeting of two units has exactly one outcome
+template<class Rules>
+constexpr bool isValidRuleSet()
+{
+    auto onBoard = [](Symbols symbol) { return symbolIndex(symbol) < symbolIndex(Symbols::empty); };
+    for (auto symbol : Rules::units0) if (!onBoard(symbol)) return false;
+    for (auto symbol : Rules::units1) if (!onBoard(symbol)) return false;
+    for (auto symbol : Rules::impassable) if (!onBoard(symbol)) return false;
+    if (!onBoard(Rules::flag0) || !onBoard(Rules::flag1)) return false;
+
+    // count how many times each cell of the outcome table is written
+    array<array<int, symbolsCount>, symbolsCount> writes{};
+    auto write = [&writes](Symbols p0, Symbols p1) { return ++writes[symbolIndex(p0)][symbolIndex(p1)] == 1; };
+
+    for (size_t i = 0; i < size(Rules::units0); ++i)
+    {
+        if (!write(Rules::units0[i], Rules::units1[i])) return false;
+    }
+    for (const auto& beat : Rules::beats)
+    {
+        int unitsCount = static_cast<int>(size(Rules::units0));
+        if (beat.first < 0 || beat.first >= unitsCount || beat.second < 0 || beat.second >= unitsCount) return false;
+        if (!write(Rules::units0[beat.first], Rules::units1[beat.second])
+                || !write(Rules::units0[beat.second], Rules::units1[beat.first])) return false;
+    }
+
+    // every pair of unit types must be either a draw or beaten one way
+    for (auto unit0 : Rules::units0)
+    {
+        for (auto unit1 : Rules::units1)
+        {
+            if (writes[symbolIndex(unit0)][symbolIndex(unit1)] != 1) return false;
+        }
+    }
+    return true;
+}
+
+// outcomes of all meetings: the first index is the symbol of player 0, the second one is of player 1
+template<class Rules>
+constexpr auto makeOutcomeTable()
+{
+    array<array<Outcome, symbolsCount>, symbolsCount> table{};
+    for (size_t i = 0; i < size(Rules::units0); ++i)
+    {
+        table[symbolIndex(Rules::units0[i])][symbolIndex(Rules::units1[i])] = Outcome::draw;
+    }
+    for (const auto& beat : Rules::beats)
+    {
+        table[symbolIndex(Rules::units0[beat.first])][symbolIndex(Rules::units1[beat.second])] = Outcome::zeroKills;
+        table[symbolIndex(Rules::units0[beat.second])][symbolIndex(Rules::units1[beat.first])] = Outcome::oneKills;
+    }
+    return table;
+}
+
+// tables compiled from a rule set, so the game doesn't pay for the rules at runtime
+template<class Rules>
+struct RuleTables
+{
+    static_assert(size(Rules::units0) == size(Rules::units1), "players must have the same unit types");
+    static_assert(symbolsCount <= 32, "symbol masks don't fit into 32 bits");
+    static_assert(isValidRuleSet<Rules>(),
+            "every symbol of the rule set must go before empty, beats must be in range "
+            "and every pair of unit types must have exactly one outcome");
+
+    static constexpr auto outcomes = makeOutcomeTable<Rules>();
+
+    // symbols which belong to player 0 and player 1
+    static constexpr uint32_t owner0 = symbolMask(Rules::units0) | 1u << symbolIndex(Rules::flag0);
+    static constexpr uint32_t owner1 = symbolMask(Rules::units1) | 1u << symbolIndex(Rules::flag1);
+    static constexpr uint32_t impassable = symbolMask(Rules::impassable);
+
+    // a player can't step on the player's own units and flag or on the impassable terrain
+    static constexpr uint32_t blocked0 = owner0 | impassable;
+    static constexpr uint32_t blocked1 = owner1 | impassable;
+
+    static constexpr Symbols flag0 = Rules::flag0;
+    static constexpr Symbols flag1 = Rules::flag1;
+};
+
+// rules of the current game
+using GameRules = RuleTables<ClassicRules>;
+
 class Position
 {
 public:
@@ -63,6 +227,106 @@ private:
     std::tuple<int, int> pos;
 };
 
+// players of the game
+enum class Player
+{
+    zero, one
+};
+
+// fog of war: cells seen by the units of one player and the symbols in them.
+// It is updated incrementally when units move or die, so no need to scan the whole board every turn
+class Visibility
+{
+public:
+    // ctor for creating a visibility where nothing is seen
+    Visibility()
+    {
+        cells.fill(Symbols::hidden);
+    }
+
+    // compute visibility from scratch for the set of units
+    void reset(const vector<vector<unique_ptr<Symbols>>>& board, const vector<pair<int, int>>& set)
+    {
+        counts = {};
+        rows = {};
+        cells.fill(Symbols::hidden);
+        for (const auto& [row, column] : set)
+        {
+            update(board, row, column, 1);
+        }
+    }
+
+    // the unit has moved from one cell to another. The board must already be updated
+    void moveUnit(const vector<vector<unique_ptr<Symbols>>>& board, const Position& from, const Position& to)
+    {
+        update(board, from.getRow(), from.getColumn(), -1);
+        update(board, to.getRow(), to.getColumn(), 1);
+    }
+
+    // the unit has been killed
+    void removeUnit(const vector<vector<unique_ptr<Symbols>>>& board, const Position& pos)
+    {
+        update(board, pos.getRow(), pos.getColumn(), -1);
+    }
+
+    // the symbol in the cell has changed
+    void cellChanged(const Position& pos, Symbols symbol)
+    {
+        if (isVisible(pos.getRow(), pos.getColumn()))
+        {
+            cells[pos.getRow() * gridSideSize + pos.getColumn()] = symbol;
+        }
+    }
+
+    // whether the cell is seen by at least one unit
+    [[nodiscard]] bool isVisible(int row, int column) const
+    {
+        return (rows[row] >> column) & 1u;
+    }
+
+    // visible cells packed as one bit per cell, row by row like the board
+    [[nodiscard]] const array<uint16_t, gridSideSize>& packedRows() const
+    {
+        return rows;
+    }
+
+    // seen symbols, row by row like the board, Symbols::hidden for the cells which are not visible
+    [[nodiscard]] const array<Symbols, gridSideSize * gridSideSize>& packedCells() const
+    {
+        return cells;
+    }
+
+private:
+    // add (or remove) a unit's field of view
+    void update(const vector<vector<unique_ptr<Symbols>>>& board, int row, int column, int delta)
+    {
+        for (int i = max(0, row - visionRadius); i <= min(gridSideSize - 1, row + visionRadius); ++i)
+        {
+            for (int j = max(0, column - visionRadius); j <= min(gridSideSize - 1, column + visionRadius); ++j)
+            {
+                counts[i][j] += delta;
+                if (counts[i][j] != 0)
+                {
+                    rows[i] |= 1u << j;
+                    cells[i * gridSideSize + j] = *board[i][j];
+                }
+                else
+                {
+                    rows[i] &= ~(1u << j);
+                    cells[i * gridSideSize + j] = Symbols::hidden;
+                }
+            }
+        }
+    }
+
+    // how many units see each cell
+    array<array<uint8_t, gridSideSize>, gridSideSize> counts{};
+    // a bit per cell: whether it is visible
+    array<uint16_t, gridSideSize> rows{};
+    // what the player sees in each cell
+    array<Symbols, gridSideSize * gridSideSize> cells{};
+};
+
 class World
 {
 public:
@@ -134,6 +398,23 @@ public:
         {
             board[tmp.first][tmp.second] = make_unique<Symbols>(Symbols::M);
         }
+
+        resetVisibility();
+    }
+
+    // compute what the players see from scratch
+    void resetVisibility()
+    {
+        vision0.reset(board, set0);
+        vision1.reset(board, set1);
+    }
+
+    // let both players see the new symbol in the cell
+    void cellChanged(const Position& pos)
+    {
+        Symbols symbol = *board[pos.getRow()][pos.getColumn()];
+        vision0.cellChanged(pos, symbol);
+        vision1.cellChanged(pos, symbol);
     }
 
     friend std::ostream& operator<<(std::ostream& out, const World& world);
@@ -176,35 +457,74 @@ public:
     vector<pair<int, int>> set0;
     // units of player 1
     vector<pair<int, int>> set1;
+
+    // cells seen by player 0 and player 1
+    Visibility vision0;
+    Visibility vision1;
 };
 
-std::ostream& operator<<(std::ostream& out, const World& world)
+// what a player is allowed to know about the world: only the cells near the player's own units
+class Observation
 {
-    // choose an appropriate char for a unit
-    auto showSymbol = [&out](const unique_ptr<Symbols>& symbolPtr)
+public:
+    // ctor for creating the observation of the player
+    Observation(const World& world, Player player)
+        :
+        vision(player == Player::zero ? world.vision0 : world.vision1),
+        set(player == Player::zero ? world.set0 : world.set1)
+    {}
+
+    // the symbol in the cell or Symbols::hidden if the player can't see it
+    [[nodiscard]] Symbols at(int row, int column) const
     {
-        switch (*symbolPtr)
-        {
-            case Symbols::s : { out << 's'; break; }
-            case Symbols::S : { out << 'S'; break; }
-            case Symbols::p : { out << 'p'; break; }
-            case Symbols::P : { out << 'P'; break; }
-            case Symbols::r : { out << 'r'; break; }
-            case Symbols::R : { out << 'R'; break; }
-            case Symbols::M : { out << 'M'; break; }
-            case Symbols::f : { out << 'f'; break; }
-            case Symbols::F : { out << 'F'; break; }
-            case Symbols::empty : { out << '_'; break; }
-        }
-    };
+        return vision.packedCells()[row * gridSideSize + column];
+    }
 
+    // units of the player
+    [[nodiscard]] const vector<pair<int, int>>& units() const
+    {
+        return set;
+    }
+
+    // visible cells of the player
+    [[nodiscard]] const Visibility& visibility() const
+    {
+        return vision;
+    }
+
+private:
+    const Visibility& vision;
+    const vector<pair<int, int>>& set;
+};
+
+// choose an appropriate char for a unit
+char symbolToChar(Symbols symbol)
+{
+    switch (symbol)
+    {
+        case Symbols::s : return 's';
+        case Symbols::S : return 'S';
+        case Symbols::p : return 'p';
+        case Symbols::P : return 'P';
+        case Symbols::r : return 'r';
+        case Symbols::R : return 'R';
+        case Symbols::M : return 'M';
+        case Symbols::f : return 'f';
+        case Symbols::F : return 'F';
+        case Symbols::empty : return '_';
+        case Symbols::hidden : return '?';
+    }
+    return '?';
+}
+
+std::ostream& operator<<(std::ostream& out, const World& world)
+{
     // print all cells on the board
     for (int i = 0; i < gridSideSize; ++i)
     {
         for (int j = 0; j < gridSideSize; ++j)
         {
-            showSymbol(world.board[i][j]);
-            out << ' ';
+            out << symbolToChar(*world.board[i][j]) << ' ';
         }
         out << endl;
     }
@@ -236,7 +556,7 @@ auto chooseSymbolRandomly(const vector<pair<int, int>>& set)
 
 // ITEM 3.c: just moves towards the enemy's flag
 // chooses an action for the player 0
-Action actionPlayerZero(const World& world)
+Action actionPlayerZero(const Observation& view)
 {
     bool successfulMove = false;
     Action action;
@@ -244,16 +564,12 @@ Action actionPlayerZero(const World& world)
     while (!successfulMove)
     {
         // randomly choose some symbol from the set && extract its coordinates
-        auto[row, column] = chooseSymbolRandomly(world.set0);
+        auto[row, column] = chooseSymbolRandomly(view.units());
 
         // ITEM 4.b: move to an orthogonal position
         if (row < column // if needs to change row and if the move will be legal
                 && row + 1 != gridSideSize
-                    && *world.board[row + 1][column] != Symbols::M
-                    && *world.board[row + 1][column] != Symbols::r
-                    && *world.board[row + 1][column] != Symbols::p
-                    && *world.board[row + 1][column] != Symbols::s
-                    && *world.board[row + 1][column] != Symbols::f)
+                    && !inMask(GameRules::blocked0, view.at(row + 1, column)))
         {
             action.from = make_unique<Position>(Position(row, column)); // old coordinates
             action.to = make_unique<Position>(Position(row + 1, column)); // increase row
@@ -262,11 +578,7 @@ Action actionPlayerZero(const World& world)
         }
             // ITEM 4.b: move to an orthogonal position
         else if (column + 1 != gridSideSize // otherwise, try to change the column if possible
-                    && *world.board[row][column + 1] != Symbols::M
-                    && *world.board[row][column + 1] != Symbols::r
-                    && *world.board[row][column + 1] != Symbols::p
-                    && *world.board[row][column + 1] != Symbols::s
-                    && *world.board[row][column + 1] != Symbols::f)
+                    && !inMask(GameRules::blocked0, view.at(row, column + 1)))
         {
             action.from = make_unique<Position>(Position(row, column)); // old coordinates
             action.to = make_unique<Position>(Position(row, column + 1)); // increase column
@@ -275,9 +587,8 @@ Action actionPlayerZero(const World& world)
         }
 
         if (count++ == 100) {
-            cout << "can't move :(" << endl;
-            exit(0);
-        } // if after 100 iterations haven't found a unit that can move - end the game
+            return Action();
+        } // if after 100 iterations haven't found a unit that can move - give up, the game controller ends the game
     }
 
     return action;
@@ -285,14 +596,14 @@ Action actionPlayerZero(const World& world)
 
 // ITEM 3.c: moves randomly
 // chooses an action for the player 1
-Action actionPlayerOne(const World& world) {
+Action actionPlayerOne(const Observation& view) {
     bool successfulMove = false;
     Action action;
     int count = 0;
     while (!successfulMove)
     {
         // randomly choose some symbol from the set && extract its coordinates
-        auto[row, column] = chooseSymbolRandomly(world.set1);
+        auto[row, column] = chooseSymbolRandomly(view.units());
         // randomly choose direction of the move
         int randChoice = rand() % 4;
         // ITEM 4.b: move to an orthogonal position
@@ -307,11 +618,7 @@ Action actionPlayerOne(const World& world) {
         auto[destRow, destColumn] = randMoves[randChoice];
         // check whether the move is possible
         if (destRow >= 0 && destRow < gridSideSize && destColumn >= 0 && destColumn < gridSideSize
-                && *world.board[destRow][destColumn] != Symbols::M
-                && *world.board[destRow][destColumn] != Symbols::S
-                && *world.board[destRow][destColumn] != Symbols::R
-                && *world.board[destRow][destColumn] != Symbols::P
-                && *world.board[destRow][destColumn] != Symbols::F)
+                && !inMask(GameRules::blocked1, view.at(destRow, destColumn)))
         {
             action.from = make_unique<Position>(Position(row, column)); // old coordinates
             action.to = make_unique<Position>(Position(destRow, destColumn)); // new coordinates
@@ -320,9 +627,8 @@ Action actionPlayerOne(const World& world) {
         }
 
         if (count++ == 100) {
-            cout << "can't move :(" << endl;
-            exit(0);
-        } // if after 100 iterations haven't found a unit that can move - end the game
+            return Action();
+        } // if after 100 iterations haven't found a unit that can move - give up, the game controller ends the game
     }
 
     return action;
@@ -331,9 +637,9 @@ Action actionPlayerOne(const World& world) {
 /**
  * The return is a pair: action and a boolean whether a timeout happened
  */
-std::tuple<Action, bool> waitPlayer(Action (*f)(const World&), const World& world) {
+std::tuple<Action, bool> waitPlayer(Action (*f)(const Observation&), const Observation& view) {
     auto start = std::chrono::high_resolution_clock::now();
-    Action action = f(world);
+    Action action = f(view);
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double, std::milli> elapsed = end - start;
 
@@ -350,14 +656,14 @@ std::tuple<bool, string> validateActions(const World& world, const Action& actio
     auto player1Dest = *action1.to; // destination of player 1
 
     // ITEM 4.c: first, process the actions and check whether there was an illegal move
-    if (*world.board[player0Dest.getRow()][player0Dest.getColumn()] == Symbols::M
+    if (inMask(GameRules::impassable, *world.board[player0Dest.getRow()][player0Dest.getColumn()])
             || action0.to == action0.from
             || player0Dest.getRow() < 0 || player0Dest.getRow() >= gridSideSize
             || player0Dest.getColumn() < 0 || player0Dest.getColumn() >= gridSideSize) // if the player 0 made an illegal move
     {
         return { true, "Player 0 made an illegal move. Player 1 won the game!"};
     }
-    else if (*world.board[player1Dest.getRow()][player1Dest.getColumn()] == Symbols::M
+    else if (inMask(GameRules::impassable, *world.board[player1Dest.getRow()][player1Dest.getColumn()])
              || action1.to == action1.from
              || player1Dest.getRow() < 0 || player1Dest.getRow() >= gridSideSize
              || player1Dest.getColumn() < 0 || player1Dest.getColumn() >= gridSideSize) // if the player 1 made an illegal move
@@ -365,11 +671,11 @@ std::tuple<bool, string> validateActions(const World& world, const Action& actio
         return { true, "Player 1 made an illegal move. Player 0 won the game!"};
     }
     // ITEM 4.d: check whether the flag was captured
-    else if (*world.board[player0Dest.getRow()][player0Dest.getColumn()] == Symbols::F) // if the player 0 captured the flag
+    else if (*world.board[player0Dest.getRow()][player0Dest.getColumn()] == GameRules::flag1) // if the player 0 captured the flag
     {
         return { true, "Player 0 captured the flag! Hooray!" };
     }
-    else if (*world.board[player1Dest.getRow()][player1Dest.getColumn()] == Symbols::f) // if the player 1 captured the flag
+    else if (*world.board[player1Dest.getRow()][player1Dest.getColumn()] == GameRules::flag0) // if the player 1 captured the flag
     {
         return { true, "Player 1 captured the flag! Hooray!" };
     }
@@ -380,30 +686,10 @@ std::tuple<bool, string> validateActions(const World& world, const Action& actio
 }
 
 // if two different symbols met in one cell
-// return a code which specifies the needed behaviour for game controller
-int interaction(const Symbols& p0, const Symbols& p1)
+// return the outcome which specifies the needed behaviour for game controller
+Outcome interaction(const Symbols& p0, const Symbols& p1)
 {
-    if (p0 == Symbols::s && p1 == Symbols::S
-            || p0 == Symbols::r && p1 == Symbols::R
-            || p0 == Symbols::p && p1 == Symbols::P // if two similar symbols met
-        )
-    {
-        return 0;
-    }
-    else if (p0 == Symbols::s && p1 == Symbols::P
-            || p0 == Symbols::r && p1 == Symbols::S
-            || p0 == Symbols::p && p1 == Symbols::R) // if unit 0 kills unit 1
-    {
-        return 1;
-    }
-    else if (p0 == Symbols::p && p1 == Symbols::S
-             || p0 == Symbols::s && p1 == Symbols::R
-             || p0 == Symbols::r && p1 == Symbols::P) // if unit 1 kills unit 0
-    {
-        return 2;
-    }
-
-    return -1;
+    return GameRules::outcomes[symbolIndex(p0)][symbolIndex(p1)];
 }
 
 
@@ -424,53 +710,60 @@ void changeCoordsInSet(vector<pair<int, int>>& set, Position& posFrom, Position&
 }
 
 // logic for moving a unit
-void playerMove(World& world, const Action& action, vector<pair<int, int>>& set)
+void playerMove(World& world, const Action& action, vector<pair<int, int>>& set, Visibility& vision)
 {
     moveUnitOnBoard(world.board, *action.from, *action.to);
     changeCoordsInSet(set, *action.from, *action.to);
+    vision.moveUnit(world.board, *action.from, *action.to);
+    world.cellChanged(*action.from);
+    world.cellChanged(*action.to);
 }
 
-void handleInteraction(int code, World& world, Position& pos0, Position& pos0to, Position& pos1, Position& pos1to)
+// returns false if the outcome can't be handled
+bool handleInteraction(Outcome outcome, World& world, Position& pos0, Position& pos0to, Position& pos1, Position& pos1to)
 {
     // ITEM 4.g: a function with logic of killing a unit
-    auto killing = [](vector<vector<unique_ptr<Symbols>>>& board, Position& pos, vector<pair<int, int>>& set)
+    auto killing = [](World& world, Position& pos, vector<pair<int, int>>& set, Visibility& vision)
     {
-        board[pos.getRow()][pos.getColumn()] = make_unique<Symbols>(Symbols::empty); // just empty the killed symbol's cell
+        world.board[pos.getRow()][pos.getColumn()] = make_unique<Symbols>(Symbols::empty); // just empty the killed symbol's cell
         auto it = find (set.begin(), set.end(), make_pair( pos.getRow(), pos.getColumn() ));
         set.erase(it);
+        vision.removeUnit(world.board, pos);
+        world.cellChanged(pos);
     };
 
-    switch (code) {
-        case 0: // ITEM 4.e: if two similar symbols met - do nothing
+    switch (outcome) {
+        case Outcome::draw: // ITEM 4.e: if two similar symbols met - do nothing
         {
             // the move is discarded
             break;
         }
-        case 1: // when player 0 kills player 1
+        case Outcome::zeroKills: // when player 0 kills player 1
         {
-            killing(world.board, pos1, world.set1);
-            playerMove(world, Action(pos0, pos0to), world.set0);
+            killing(world, pos1, world.set1, world.vision1);
+            playerMove(world, Action(pos0, pos0to), world.set0, world.vision0);
 
             break;
         }
-        case 2: // when player 1 kills player 0
+        case Outcome::oneKills: // when player 1 kills player 0
         {
-            killing(world.board, pos0, world.set0);
-            playerMove(world, Action(pos1, pos1to), world.set1);
+            killing(world, pos0, world.set0, world.vision0);
+            playerMove(world, Action(pos1, pos1to), world.set1, world.vision1);
 
             break;
         }
         default:
         {
-            cout << "problem" << endl;
-            exit(0);
-            break;
+            return false;
         }
     }
+
+    return true;
 }
 
 // take actions and move units, update the state of the world
-void updateWorld(World& world, Action& action0, Action& action1)
+// returns false if the units met in a way the rules don't describe
+bool updateWorld(World& world, Action& action0, Action& action1)
 {
 
     if (*action0.to == *action1.from && *action0.from == *action1.to) // in case the unit just swap places
@@ -479,118 +772,293 @@ void updateWorld(World& world, Action& action0, Action& action1)
         auto it0 = find (world.set0.begin(), world.set0.end(), make_pair( action0.from->getRow(), action0.from->getColumn() ));
         auto it1 = find (world.set1.begin(), world.set1.end(), make_pair( action1.from->getRow(), action1.from->getColumn() ));
         swap(*it0, *it1);
+        world.vision0.moveUnit(world.board, *action0.from, *action0.to);
+        world.vision1.moveUnit(world.board, *action1.from, *action1.to);
+        world.cellChanged(*action0.to);
+        world.cellChanged(*action1.to);
 
-        return;
+        return true;
     }
     else if (*action0.to == *action1.from) // if unit 0 goes to the initial place of unit 1
     {
-        int code = interaction(
+        Outcome outcome = interaction(
                 *world.board[action1.to->getRow()][action1.to->getColumn()],
                 *world.board[action1.from->getRow()][action1.from->getColumn()]
         );
-        if (code == -1)
-            playerMove(world, action1, world.set1);
-        else
-            handleInteraction(code, world, *action1.to, *action1.to, *action1.from, *action1.to);
+        if (outcome == Outcome::none)
+            playerMove(world, action1, world.set1, world.vision1);
+        else if (!handleInteraction(outcome, world, *action1.to, *action1.to, *action1.from, *action1.to))
+            return false;
 
-        code = interaction(
+        outcome = interaction(
                 *world.board[action0.from->getRow()][action0.from->getColumn()],
                 *world.board[action0.to->getRow()][action0.to->getColumn()]
         );
-        if (code == -1)
-            playerMove(world, action0, world.set0);
-        else
-            handleInteraction(code, world, *action0.from, *action0.to, *action0.to, *action0.to);
+        if (outcome == Outcome::none)
+            playerMove(world, action0, world.set0, world.vision0);
+        else if (!handleInteraction(outcome, world, *action0.from, *action0.to, *action0.to, *action0.to))
+            return false;
     }
     else if (*action1.to == *action0.from) // if unit 1 goes to the initial place of unit 0
     {
-        int code = interaction(
+        Outcome outcome = interaction(
                 *world.board[action0.from->getRow()][action0.from->getColumn()],
                 *world.board[action0.to->getRow()][action0.to->getColumn()]
         );
-        if (code == -1)
-            playerMove(world, action0, world.set0);
-        else
-            handleInteraction(code, world, *action0.from, *action0.to, *action0.to, *action0.to);
+        if (outcome == Outcome::none)
+            playerMove(world, action0, world.set0, world.vision0);
+        else if (!handleInteraction(outcome, world, *action0.from, *action0.to, *action0.to, *action0.to))
+            return false;
 
-        code = interaction(
+        outcome = interaction(
                 *world.board[action1.to->getRow()][action1.to->getColumn()],
                 *world.board[action1.from->getRow()][action1.from->getColumn()]
         );
-        if (code == -1)
-            playerMove(world, action1, world.set1);
-        else
-            handleInteraction(code, world, *action1.to, *action1.to, *action1.from, *action1.to);
+        if (outcome == Outcome::none)
+            playerMove(world, action1, world.set1, world.vision1);
+        else if (!handleInteraction(outcome, world, *action1.to, *action1.to, *action1.from, *action1.to))
+            return false;
     }
     else if (*action0.to == *action1.to) // if units 0 and 1 move to the same place
     {
-        int code = interaction(
+        Outcome outcome = interaction(
                 *world.board[action0.from->getRow()][action0.from->getColumn()],
                 *world.board[action1.from->getRow()][action1.from->getColumn()]
         );
 
-        handleInteraction(code, world, *action0.from, *action0.to, *action1.from, *action1.to);
+        if (!handleInteraction(outcome, world, *action0.from, *action0.to, *action1.from, *action1.to))
+            return false;
     }
     else // if moves of unit 0 and unit 1 are independent
     {
         {
-            int code = interaction(
+            Outcome outcome = interaction(
                     *world.board[action0.from->getRow()][action0.from->getColumn()],
                     *world.board[action0.to->getRow()][action0.to->getColumn()]
             );
 
-            if (code == -1)
-                playerMove(world, action0, world.set0);
-            else
-                handleInteraction(code, world, *action0.from, *action0.to, *action0.to, *action0.to);
+            if (outcome == Outcome::none)
+                playerMove(world, action0, world.set0, world.vision0);
+            else if (!handleInteraction(outcome, world, *action0.from, *action0.to, *action0.to, *action0.to))
+                return false;
         }
 
         {
-            int code = interaction(
+            Outcome outcome = interaction(
                     *world.board[action1.to->getRow()][action1.to->getColumn()],
                     *world.board[action1.from->getRow()][action1.from->getColumn()]
             );
 
-            if (code == -1)
-                playerMove(world, action1, world.set1);
-            else
-                handleInteraction(code, world, *action1.to, *action1.to, *action1.from, *action1.to);
+            if (outcome == Outcome::none)
+                playerMove(world, action1, world.set1, world.vision1);
+            else if (!handleInteraction(outcome, world, *action1.to, *action1.to, *action1.from, *action1.to))
+                return false;
         }
     }
+
+    return true;
 }
 
-// ITEM 3.d: all of three of the following methods implement the unique feature:
+// ITEM 3.d: the following code implements the unique feature:
 // save the game to a file and start new game with saved process
 
-// save the state of the world to the file
-void saveProgress(const World& world)
+// a copy of the state of the world which can be saved without touching the world
+struct Snapshot
 {
-    ofstream file("savefile.txt");
-    if (file.is_open())
+    // copy the world. Reuses the memory of the previous copy
+    void copyFrom(const World& world)
     {
-        // save board
-        file << "Board" << endl;
-        file << world;
-
-        // save set 0
-        file << "Set 0" << endl;
-        for (int i = 0; i < world.set0.size(); ++i)
+        for (int i = 0; i < gridSideSize; ++i)
         {
-            file << world.set0[i].first << " " << world.set0[i].second << endl;
+            for (int j = 0; j < gridSideSize; ++j)
+            {
+                board[i * gridSideSize + j] = *world.board[i][j];
+            }
         }
+        set0.assign(world.set0.begin(), world.set0.end());
+        set1.assign(world.set1.begin(), world.set1.end());
+    }
 
-        // save set 1
-        file << "Set 1" << endl;
-        for (int i = 0; i < world.set1.size(); ++i)
+    array<Symbols, gridSideSize * gridSideSize> board{};
+    vector<pair<int, int>> set0;
+    vector<pair<int, int>> set1;
+};
+
+// flush the data of the file to the disk, not only to the OS
+bool syncFile(FILE* file)
+{
+    if (fflush(file) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// atomically replace the file at path (if it exists) with the file at tmpPath
+bool replaceFile(const string& tmpPath, const string& path)
+{
+#ifdef _WIN32
+    return MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) return false;
+
+    // sync the directory, so the rename itself survives a power loss.
+    // The save is already in place, so this is best effort
+    auto slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+    return true;
+#endif
+}
+
+// save the snapshot to the file. The file is written atomically and synced to the disk:
+// first to a temporary file, which then replaces the old save
+bool writeSnapshot(const Snapshot& snapshot, const string& path)
+{
+    ostringstream out;
+
+    // save board
+    out << "Board\n";
+    for (int i = 0; i < gridSideSize; ++i)
+    {
+        for (int j = 0; j < gridSideSize; ++j)
         {
-            file << world.set1[i].first << " " << world.set1[i].second << endl;
+            out << symbolToChar(snapshot.board[i * gridSideSize + j]) << ' ';
         }
-        file << "End" << endl;
+        out << '\n';
+    }
+
+    // save set 0
+    out << "Set 0\n";
+    for (const auto& [row, column] : snapshot.set0)
+    {
+        out << row << ' ' << column << '\n';
+    }
+
+    // save set 1
+    out << "Set 1\n";
+    for (const auto& [row, column] : snapshot.set1)
+    {
+        out << row << ' ' << column << '\n';
+    }
+    out << "End\n";
+
+    string tmpPath = path + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "w");
+    if (file == nullptr) return false;
 
-        file.close();
+    string content = out.str();
+    bool written = fwrite(content.data(), 1, content.size(), file) == content.size() && syncFile(file);
+    written = fclose(file) == 0 && written;
+
+    if (!written || !replaceFile(tmpPath, path))
+    {
+        remove(tmpPath.c_str());
+        return false;
     }
+    return true;
 }
 
+// saves the game periodically without blocking the game thread:
+// the game thread only copies the world into one of two buffers,
+// and a background thread writes the other one to the file
+class AutoSaver
+{
+public:
+    // ctor for creating an auto saver. 0 turns or 0 seconds disable the corresponding trigger
+    AutoSaver(string path, int everyTurns, chrono::seconds everyPeriod)
+        :
+        path(move(path)),
+        everyTurns(everyTurns),
+        everyPeriod(everyPeriod),
+        lastSave(chrono::steady_clock::now()),
+        writer(&AutoSaver::writerLoop, this)
+    {}
+
+    AutoSaver(const AutoSaver&) = delete;
+    AutoSaver& operator=(const AutoSaver&) = delete;
+
+    // write the last requested snapshot and stop the writer
+    ~AutoSaver()
+    {
+        {
+            lock_guard<mutex> lock(m);
+            stop = true;
+        }
+        cv.notify_one();
+        writer.join();
+    }
+
+    // called by the game thread after every turn. Saves the world if it is time to
+    void onTurn(const World& world)
+    {
+        auto now = chrono::steady_clock::now();
+        ++turns;
+        if ((everyTurns > 0 && turns >= everyTurns)
+                || (everyPeriod.count() > 0 && now - lastSave >= everyPeriod))
+        {
+            save(world);
+            turns = 0;
+            lastSave = now;
+        }
+    }
+
+    // copy the world and ask the writer to save it
+    void save(const World& world)
+    {
+        {
+            // the writer holds the lock only to swap the buffers, so this waits for nothing but the copy
+            lock_guard<mutex> lock(m);
+            buffers[back].copyFrom(world);
+            pending = true;
+        }
+        cv.notify_one();
+    }
+
+private:
+    void writerLoop()
+    {
+        unique_lock<mutex> lock(m);
+        while (true)
+        {
+            cv.wait(lock, [this] { return pending || stop; });
+            if (!pending) return;
+
+            // take the filled buffer and give the other one to the game thread
+            int front = back;
+            back = 1 - back;
+            pending = false;
+
+            lock.unlock();
+            if (!writeSnapshot(buffers[front], path))
+            {
+                cerr << "failed to save the game to " << path << endl;
+            }
+            lock.lock();
+        }
+    }
+
+    string path;
+    int everyTurns;
+    chrono::seconds everyPeriod;
+    int turns = 0; // turns since the last save
+    chrono::steady_clock::time_point lastSave;
+
+    array<Snapshot, 2> buffers;
+    int back = 0; // the buffer which the game thread fills
+    bool pending = false; // whether the back buffer has a snapshot to be written
+    bool stop = false;
+    mutex m;
+    condition_variable cv;
+    thread writer; // declared last, so it starts when everything else is ready
+};
+
 // parse the save file. Create the world
 World startSavedGame()
 {
@@ -644,6 +1112,8 @@ World startSavedGame()
         {
             world.set1.emplace_back( stoi(i), stoi(j) );
         }
+
+        world.resetVisibility();
     }
 
     return world;
@@ -672,14 +1142,14 @@ int main() {
     World world;
     gameStart(world);
     cout << world;
-    int count = 0;
+    AutoSaver autoSaver("savefile.txt", AUTOSAVE_TURNS, AUTOSAVE_PERIOD);
 
     bool endGame = false;
     while (!endGame) {
         // ITEM 3: once per second
         this_thread::sleep_for(1000ms);
-        auto[action0, timeout0] = waitPlayer(actionPlayerZero, world);
-        auto[action1, timeout1] = waitPlayer(actionPlayerOne, world);
+        auto[action0, timeout0] = waitPlayer(actionPlayerZero, Observation(world, Player::zero));
+        auto[action1, timeout1] = waitPlayer(actionPlayerOne, Observation(world, Player::one));
 
         if (timeout0 || timeout1)
         {
@@ -687,16 +1157,26 @@ int main() {
             if (timeout0) cout << "Player 1 won. Player 0, you are a slowpoke!" << endl;
             else cout << "Player 0 won. Player 1, you are a slowpoke!" << endl;
         }
+        else if (!action0.from || !action1.from) // a player didn't find a unit that can move
+        {
+            endGame = true;
+            cout << "can't move :(" << endl;
+        }
         else
         {
             string message;
             tie(endGame, message) = validateActions(world, action0, action1);
 
-            updateWorld(world, action0, action1);
+            if (!updateWorld(world, action0, action1))
+            {
+                cout << "problem" << endl;
+                break;
+            }
             cout << world;
 
-            // save the game after 50 iterations
-            if (count++ == 50) saveProgress(world);
+            // save the game in the background while it goes on. The final board
+            // (e.g. with a captured flag) is not a game that can be continued
+            if (!endGame) autoSaver.onTurn(world);
             // print a message if the game has ended
             if (endGame)
             {